@@ -0,0 +1,1129 @@
+// microbenchmarks for muse's hot paths.
+// build with `make bench`, run `./muse-bench` for the list of benchmarks.
+#define MUSE_NO_MAIN
+#include "muse.c"
+
+static uint32_t bench_state = 0x9e3779b9u;
+
+static uint32_t bench_random(void) {
+    bench_state ^= bench_state << 13;
+    bench_state ^= bench_state >> 17;
+    bench_state ^= bench_state << 5;
+    return bench_state;
+}
+
+static Color *random_colors(int count) {
+    Color *colors = malloc(count * sizeof(Color));
+    if (!colors) {
+        fprintf(stderr, "error: could not allocate memory for benchmark.\n");
+        exit(1);
+    }
+    for (int i = 0; i < count; i++) {
+        uint32_t v = bench_random();
+        colors[i].r = v & 0xff;
+        colors[i].g = (v >> 8) & 0xff;
+        colors[i].b = (v >> 16) & 0xff;
+    }
+    return colors;
+}
+
+static Theme random_theme(int num_colors) {
+    Theme theme;
+    memset(&theme, 0, sizeof(theme));
+    snprintf(theme.name, sizeof(theme.name), "random-%d", num_colors);
+    Color *colors = random_colors(num_colors);
+    memcpy(theme.palette, colors, num_colors * sizeof(Color));
+    theme.num_colors = num_colors;
+    free(colors);
+    return theme;
+}
+
+#define SEARCH_LOOKUPS (1 << 20)
+
+static void bench_search_theme(const Theme *theme, DistanceMetric metric, const Color *pixels) {
+    PaletteIndex *index = malloc(sizeof(PaletteIndex));
+    build_palette_index(theme, metric, index);
+
+    volatile int sink = 0;
+    double start = now_seconds();
+    for (int i = 0; i < SEARCH_LOOKUPS; i++) sink += find_closest_index_soa(&index->soa, pixels[i]);
+    double scan = now_seconds() - start;
+
+    start = now_seconds();
+    for (int i = 0; i < SEARCH_LOOKUPS; i++) sink += find_closest_index_tree(index, pixels[i]);
+    double tree = now_seconds() - start;
+
+    int mismatches = 0;
+    for (int i = 0; i < SEARCH_LOOKUPS; i++) {
+        mismatches += find_closest_index_soa(&index->soa, pixels[i]) != find_closest_index_tree(index, pixels[i]);
+    }
+
+    printf("%-20s %4d %-7s %10.2f %10.2f  %-7s %d\n", theme->name, theme->num_colors, metric_names[metric],
+           SEARCH_LOOKUPS / scan / 1e6, SEARCH_LOOKUPS / tree / 1e6,
+           index->strategy == SEARCH_KD_TREE ? "kd-tree" : "scan", mismatches);
+    free(index);
+}
+
+static const DistanceMetric tree_metrics[] = { METRIC_RGB, METRIC_CIELAB, METRIC_OKLAB };
+
+// lookups per second of each nearest-color strategy, for the given palettes
+// and for random palettes of growing size
+static int bench_search(int argc, char **argv) {
+    Color *pixels = random_colors(SEARCH_LOOKUPS);
+    printf("%-20s %4s %-7s %10s %10s  %-7s %s\n", "palette", "size", "metric", "scan M/s", "tree M/s", "picked", "mismatches");
+    for (size_t m = 0; m < sizeof(tree_metrics) / sizeof(tree_metrics[0]); m++) {
+        for (int i = 0; i < argc; i++) {
+            Theme theme = load_palette_file(argv[i]);
+            if (theme.num_colors > 0) bench_search_theme(&theme, tree_metrics[m], pixels);
+        }
+        static const int sizes[] = { 8, 16, 32, 48, 64, 128, 256 };
+        for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+            Theme theme = random_theme(sizes[i]);
+            bench_search_theme(&theme, tree_metrics[m], pixels);
+        }
+    }
+    free(pixels);
+    return 0;
+}
+
+static void bench_metrics_theme(const Theme *theme) {
+    printf("%-20s %4d", theme->name, theme->num_colors);
+    for (int m = METRIC_RGB; m <= METRIC_CIEDE2000; m++) {
+        distance_metric = (DistanceMetric)m;
+        build_palette_index(theme, distance_metric, &palette_index);
+        double start = now_seconds();
+        initialize_cache();
+        printf(" %10.2f", (now_seconds() - start) * 1000.0);
+        free_cache();
+    }
+    printf("\n");
+}
+
+// time to build the default rgb565 cache under each distance metric
+static int bench_metrics(int argc, char **argv) {
+    printf("%-20s %4s", "palette", "size");
+    for (int m = METRIC_RGB; m <= METRIC_CIEDE2000; m++) printf(" %7s ms", metric_names[m]);
+    printf("\n");
+    for (int i = 0; i < argc; i++) {
+        Theme theme = load_palette_file(argv[i]);
+        if (theme.num_colors > 0) bench_metrics_theme(&theme);
+    }
+    Theme theme = random_theme(256);
+    bench_metrics_theme(&theme);
+    return 0;
+}
+
+// the packed rgb ring the legacy loops were written against
+typedef struct {
+    const PixelSource *src;
+    float *rows;
+    int num_rows;
+} LegacyRows;
+
+static float *legacy_row(LegacyRows *ring, int y) {
+    return ring->rows + (size_t)(y % ring->num_rows) * ring->src->width * 3;
+}
+
+static void legacy_enter_row(LegacyRows *ring, int y) {
+    if (y < ring->src->height) load_source_row(ring->src, y, legacy_row(ring, y));
+}
+
+static void legacy_open_rows(LegacyRows *ring, const PixelSource *src, int num_rows) {
+    ring->src = src;
+    ring->num_rows = num_rows;
+    ring->rows = malloc((size_t)num_rows * src->width * 3 * sizeof(float));
+    if (!ring->rows) {
+        fprintf(stderr, "error: could not allocate memory for benchmark.\n");
+        exit(1);
+    }
+    for (int y = 0; y < num_rows; y++) legacy_enter_row(ring, y);
+}
+
+static void legacy_close_rows(LegacyRows *ring) {
+    free(ring->rows);
+}
+
+// the per-kernel diffusion loops muse used before the table-driven engine,
+// kept as the baseline the engine is measured and checked against
+ALWAYS_INLINE void legacy_floyd_steinberg_dither(const PixelSource *src, uint8_t *indices, const Theme *theme,
+                                          CachePrecision precision) {
+    int width = src->width, height = src->height;
+    LegacyRows ring;
+    legacy_open_rows(&ring, src, 2);
+    for (int y = 0; y < height; y++) {
+        float *row = legacy_row(&ring, y);
+        float *below = legacy_row(&ring, y + 1);
+        for (int x = 0; x < width; x++) {
+            int idx = x * 3;
+            Color old_pixel = {
+                clamp_float(row[idx]),
+                clamp_float(row[idx + 1]),
+                clamp_float(row[idx + 2])
+            };
+            int index = cache_lookup(precision, old_pixel);
+            indices[y * width + x] = index;
+            Color new_pixel = theme->palette[index];
+
+            float err_r = (float)old_pixel.r - (float)new_pixel.r;
+            float err_g = (float)old_pixel.g - (float)new_pixel.g;
+            float err_b = (float)old_pixel.b - (float)new_pixel.b;
+
+            if (x + 1 < width) {
+                int right = idx + 3;
+                row[right]     += err_r * 7.0f / 16.0f;
+                row[right + 1] += err_g * 7.0f / 16.0f;
+                row[right + 2] += err_b * 7.0f / 16.0f;
+            }
+            if (y + 1 < height) {
+                if (x > 0) {
+                    int bottom_left = idx - 3;
+                    below[bottom_left]     += err_r * 3.0f / 16.0f;
+                    below[bottom_left + 1] += err_g * 3.0f / 16.0f;
+                    below[bottom_left + 2] += err_b * 3.0f / 16.0f;
+                }
+                int bottom = idx;
+                below[bottom]     += err_r * 5.0f / 16.0f;
+                below[bottom + 1] += err_g * 5.0f / 16.0f;
+                below[bottom + 2] += err_b * 5.0f / 16.0f;
+
+                if (x + 1 < width) {
+                    int bottom_right = idx + 3;
+                    below[bottom_right]     += err_r * 1.0f / 16.0f;
+                    below[bottom_right + 1] += err_g * 1.0f / 16.0f;
+                    below[bottom_right + 2] += err_b * 1.0f / 16.0f;
+                }
+            }
+        }
+        legacy_enter_row(&ring, y + ring.num_rows);
+    }
+    legacy_close_rows(&ring);
+}
+
+static void legacy_floyd_steinberg(const PixelSource *src, uint8_t *indices, const Theme *theme) {
+    DISPATCH_PRECISION(legacy_floyd_steinberg_dither, src, indices, theme);
+}
+
+ALWAYS_INLINE void legacy_jjn_dither(const PixelSource *src, uint8_t *indices, const Theme *theme,
+                              CachePrecision precision) {
+    int width = src->width, height = src->height;
+    LegacyRows ring;
+    legacy_open_rows(&ring, src, 2);
+    for (int y = 0; y < height; y++) {
+        float *row = legacy_row(&ring, y);
+        float *below = legacy_row(&ring, y + 1);
+        for (int x = 0; x < width; x++) {
+            int idx = x * 3;
+            Color old_pixel = {
+                clamp_float(row[idx]),
+                clamp_float(row[idx + 1]),
+                clamp_float(row[idx + 2])
+            };
+            int index = cache_lookup(precision, old_pixel);
+            indices[y * width + x] = index;
+            Color new_pixel = theme->palette[index];
+
+            float err_r = (float)old_pixel.r - (float)new_pixel.r;
+            float err_g = (float)old_pixel.g - (float)new_pixel.g;
+            float err_b = (float)old_pixel.b - (float)new_pixel.b;
+
+            if (x + 1 < width) {
+                int right = idx + 3;
+                row[right]     += err_r * 7.0f / 48.0f;
+                row[right + 1] += err_g * 7.0f / 48.0f;
+                row[right + 2] += err_b * 7.0f / 48.0f;
+            }
+            if (x + 2 < width) {
+                int right2 = idx + 6;
+                row[right2]     += err_r * 5.0f / 48.0f;
+                row[right2 + 1] += err_g * 5.0f / 48.0f;
+                row[right2 + 2] += err_b * 5.0f / 48.0f;
+            }
+            if (y + 1 < height) {
+                if (x > 0) {
+                    int bottom_left = idx - 3;
+                    below[bottom_left]     += err_r * 3.0f / 48.0f;
+                    below[bottom_left + 1] += err_g * 3.0f / 48.0f;
+                    below[bottom_left + 2] += err_b * 3.0f / 48.0f;
+                }
+                int bottom = idx;
+                below[bottom]     += err_r * 5.0f / 48.0f;
+                below[bottom + 1] += err_g * 5.0f / 48.0f;
+                below[bottom + 2] += err_b * 5.0f / 48.0f;
+
+                if (x + 1 < width) {
+                    int bottom_right = idx + 3;
+                    below[bottom_right]     += err_r * 7.0f / 48.0f;
+                    below[bottom_right + 1] += err_g * 7.0f / 48.0f;
+                    below[bottom_right + 2] += err_b * 7.0f / 48.0f;
+                }
+                if (x + 2 < width) {
+                    int bottom_right2 = idx + 6;
+                    below[bottom_right2]     += err_r * 5.0f / 48.0f;
+                    below[bottom_right2 + 1] += err_g * 5.0f / 48.0f;
+                    below[bottom_right2 + 2] += err_b * 5.0f / 48.0f;
+                }
+            }
+        }
+        legacy_enter_row(&ring, y + ring.num_rows);
+    }
+    legacy_close_rows(&ring);
+}
+
+static void legacy_jjn(const PixelSource *src, uint8_t *indices, const Theme *theme) {
+    DISPATCH_PRECISION(legacy_jjn_dither, src, indices, theme);
+}
+
+ALWAYS_INLINE void legacy_sierra_dither(const PixelSource *src, uint8_t *indices, const Theme *theme,
+                                 CachePrecision precision) {
+    int width = src->width, height = src->height;
+    LegacyRows ring;
+    legacy_open_rows(&ring, src, 2);
+    for (int y = 0; y < height; y++) {
+        float *row = legacy_row(&ring, y);
+        float *below = legacy_row(&ring, y + 1);
+        for (int x = 0; x < width; x++) {
+            int idx = x * 3;
+            Color old_pixel = {
+                clamp_float(row[idx]),
+                clamp_float(row[idx + 1]),
+                clamp_float(row[idx + 2])
+            };
+            int index = cache_lookup(precision, old_pixel);
+            indices[y * width + x] = index;
+            Color new_pixel = theme->palette[index];
+
+            float err_r = (float)old_pixel.r - (float)new_pixel.r;
+            float err_g = (float)old_pixel.g - (float)new_pixel.g;
+            float err_b = (float)old_pixel.b - (float)new_pixel.b;
+
+            if (x + 1 < width) {
+                int right = idx + 3;
+                row[right]     += err_r * 5.0f / 32.0f;
+                row[right + 1] += err_g * 5.0f / 32.0f;
+                row[right + 2] += err_b * 5.0f / 32.0f;
+            }
+            if (x + 2 < width) {
+                int right2 = idx + 6;
+                row[right2]     += err_r * 3.0f / 32.0f;
+                row[right2 + 1] += err_g * 3.0f / 32.0f;
+                row[right2 + 2] += err_b * 3.0f / 32.0f;
+            }
+            if (y + 1 < height) {
+                if (x > 0) {
+                    int bottom_left = idx - 3;
+                    below[bottom_left]     += err_r * 2.0f / 32.0f;
+                    below[bottom_left + 1] += err_g * 2.0f / 32.0f;
+                    below[bottom_left + 2] += err_b * 2.0f / 32.0f;
+                }
+                int bottom = idx;
+                below[bottom]     += err_r * 4.0f / 32.0f;
+                below[bottom + 1] += err_g * 4.0f / 32.0f;
+                below[bottom + 2] += err_b * 4.0f / 32.0f;
+
+                if (x + 1 < width) {
+                    int bottom_right = idx + 3;
+                    below[bottom_right]     += err_r * 5.0f / 32.0f;
+                    below[bottom_right + 1] += err_g * 5.0f / 32.0f;
+                    below[bottom_right + 2] += err_b * 5.0f / 32.0f;
+                }
+                if (x + 2 < width) {
+                    int bottom_right2 = idx + 6;
+                    below[bottom_right2]     += err_r * 3.0f / 32.0f;
+                    below[bottom_right2 + 1] += err_g * 3.0f / 32.0f;
+                    below[bottom_right2 + 2] += err_b * 3.0f / 32.0f;
+                }
+            }
+        }
+        legacy_enter_row(&ring, y + ring.num_rows);
+    }
+    legacy_close_rows(&ring);
+}
+
+static void legacy_sierra(const PixelSource *src, uint8_t *indices, const Theme *theme) {
+    DISPATCH_PRECISION(legacy_sierra_dither, src, indices, theme);
+}
+
+ALWAYS_INLINE void legacy_atkinson_dither(const PixelSource *src, uint8_t *indices, const Theme *theme,
+                                   CachePrecision precision) {
+    int width = src->width, height = src->height;
+    LegacyRows ring;
+    legacy_open_rows(&ring, src, 3);
+    for (int y = 0; y < height; y++) {
+        float *row = legacy_row(&ring, y);
+        for (int x = 0; x < width; x++) {
+            int idx = x * 3;
+            Color old_pixel = {
+                clamp_float(row[idx]),
+                clamp_float(row[idx + 1]),
+                clamp_float(row[idx + 2])
+            };
+            int index = cache_lookup(precision, old_pixel);
+            indices[y * width + x] = index;
+            Color new_pixel = theme->palette[index];
+
+            float err_r = ((float)old_pixel.r - (float)new_pixel.r) / 8.0f;
+            float err_g = ((float)old_pixel.g - (float)new_pixel.g) / 8.0f;
+            float err_b = ((float)old_pixel.b - (float)new_pixel.b) / 8.0f;
+
+            // Distribute error to 6 neighboring pixels
+            int offsets[][2] = {{1,0}, {2,0}, {-1,1}, {0,1}, {1,1}, {0,2}};
+            for (int i = 0; i < 6; i++) {
+                int nx = x + offsets[i][0];
+                int ny = y + offsets[i][1];
+                if (nx >= 0 && nx < width && ny < height) {
+                    float *n = legacy_row(&ring, ny) + nx * 3;
+                    n[0] += err_r;
+                    n[1] += err_g;
+                    n[2] += err_b;
+                }
+            }
+        }
+        legacy_enter_row(&ring, y + ring.num_rows);
+    }
+    legacy_close_rows(&ring);
+}
+
+static void legacy_atkinson(const PixelSource *src, uint8_t *indices, const Theme *theme) {
+    DISPATCH_PRECISION(legacy_atkinson_dither, src, indices, theme);
+}
+
+ALWAYS_INLINE void legacy_stucki_dither(const PixelSource *src, uint8_t *indices, const Theme *theme,
+                                 CachePrecision precision) {
+    int width = src->width, height = src->height;
+    LegacyRows ring;
+    legacy_open_rows(&ring, src, 3);
+    for (int y = 0; y < height; y++) {
+        float *row = legacy_row(&ring, y);
+        for (int x = 0; x < width; x++) {
+            int idx = x * 3;
+            Color old_pixel = {
+                clamp_float(row[idx]),
+                clamp_float(row[idx + 1]),
+                clamp_float(row[idx + 2])
+            };
+            int index = cache_lookup(precision, old_pixel);
+            indices[y * width + x] = index;
+            Color new_pixel = theme->palette[index];
+
+            float err_r = (float)old_pixel.r - (float)new_pixel.r;
+            float err_g = (float)old_pixel.g - (float)new_pixel.g;
+            float err_b = (float)old_pixel.b - (float)new_pixel.b;
+
+            // Error distribution matrix (Stucki)
+            struct { int x, y; float w; } pattern[] = {
+                {1, 0, 8/42.0f}, {2, 0, 4/42.0f},
+                {-2, 1, 2/42.0f}, {-1, 1, 4/42.0f}, {0, 1, 8/42.0f}, {1, 1, 4/42.0f}, {2, 1, 2/42.0f},
+                {-2, 2, 1/42.0f}, {-1, 2, 2/42.0f}, {0, 2, 4/42.0f}, {1, 2, 2/42.0f}, {2, 2, 1/42.0f}
+            };
+
+            for (size_t i = 0; i < sizeof(pattern)/sizeof(pattern[0]); i++) {
+                int nx = x + pattern[i].x;
+                int ny = y + pattern[i].y;
+                if (nx >= 0 && nx < width && ny < height) {
+                    float *n = legacy_row(&ring, ny) + nx * 3;
+                    n[0] += err_r * pattern[i].w;
+                    n[1] += err_g * pattern[i].w;
+                    n[2] += err_b * pattern[i].w;
+                }
+            }
+        }
+        legacy_enter_row(&ring, y + ring.num_rows);
+    }
+    legacy_close_rows(&ring);
+}
+
+static void legacy_stucki(const PixelSource *src, uint8_t *indices, const Theme *theme) {
+    DISPATCH_PRECISION(legacy_stucki_dither, src, indices, theme);
+}
+
+typedef void (*DitherFn)(const PixelSource *src, uint8_t *indices, const Theme *theme);
+
+static const struct {
+    const char *name;
+    DitherMethod method;
+    DitherFn legacy;
+} diffusion_kernels[] = {
+    { "floyd", DITHER_FLOYD_STEINBERG, legacy_floyd_steinberg },
+    { "jjn", DITHER_JJN, legacy_jjn },
+    { "sierra", DITHER_SIERRA, legacy_sierra },
+    { "atkinson", DITHER_ATKINSON, legacy_atkinson },
+    { "stucki", DITHER_STUCKI, legacy_stucki },
+    { "burkes", DITHER_BURKES, NULL },
+    { "sierra2", DITHER_SIERRA2, NULL },
+    { "sierra-lite", DITHER_SIERRA_LITE, NULL },
+    { "shiau-fan", DITHER_SHIAU_FAN, NULL },
+};
+
+#define DIFFUSION_WIDTH 2048
+#define DIFFUSION_HEIGHT 1024
+#define DIFFUSION_ROUNDS 3
+
+// best of a few runs, in megapixels per second
+static double time_dither(DitherFn legacy, DitherMethod method, const PixelSource *src, uint8_t *indices,
+                          const Theme *theme) {
+    double best = INFINITY;
+    for (int round = 0; round < DIFFUSION_ROUNDS; round++) {
+        double start = now_seconds();
+        if (legacy) legacy(src, indices, theme);
+        else apply_error_diffusion_dither(method, src, indices, theme);
+        double elapsed = now_seconds() - start;
+        if (elapsed < best) best = elapsed;
+    }
+    return (double)src->width * src->height / best / 1e6;
+}
+
+// a smooth gradient with some noise, so diffused errors stay in a realistic range
+static unsigned char *synthetic_frame(int width, int height) {
+    unsigned char *pixels = malloc((size_t)width * height * 3);
+    if (!pixels) {
+        fprintf(stderr, "error: could not allocate memory for benchmark.\n");
+        exit(1);
+    }
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            unsigned char *p = pixels + ((size_t)y * width + x) * 3;
+            uint32_t noise = bench_random();
+            p[0] = (x * 255 / width + (noise & 15)) & 0xff;
+            p[1] = (y * 255 / height + ((noise >> 8) & 15)) & 0xff;
+            p[2] = ((x + y) * 255 / (width + height) + ((noise >> 16) & 15)) & 0xff;
+        }
+    }
+    return pixels;
+}
+
+// the setup every dithering benchmark shares: a theme with its cache, a
+// synthetic frame, and an expected and actual index buffer to compare
+typedef struct {
+    Theme theme;
+    PixelSource src;
+    size_t num_pixels;
+    uint8_t *expected;
+    uint8_t *actual;
+} DitherBench;
+
+typedef void (*DitherBenchFn)(DitherBench *bench, void *ctx);
+
+// loads the palette at path, or a random 16-color one when path is NULL,
+// and hands a width x height frame to body
+static int run_dither_bench(const char *path, int width, int height, DitherBenchFn body, void *ctx) {
+    DitherBench bench = { .theme = path ? load_palette_file(path) : random_theme(16) };
+    if (bench.theme.num_colors == 0) return 1;
+    build_palette_index(&bench.theme, distance_metric, &palette_index);
+    initialize_cache();
+
+    bench.num_pixels = (size_t)width * height;
+    unsigned char *pixels = synthetic_frame(width, height);
+    bench.expected = malloc(bench.num_pixels);
+    bench.actual = malloc(bench.num_pixels);
+    if (!bench.expected || !bench.actual) {
+        fprintf(stderr, "error: could not allocate memory for benchmark.\n");
+        return 1;
+    }
+    bench.src = (PixelSource){ .pixels = pixels, .width = width, .height = height };
+
+    body(&bench, ctx);
+
+    free(pixels);
+    free(bench.expected);
+    free(bench.actual);
+    free_cache();
+    return 0;
+}
+
+static int same_indices(const DitherBench *bench) {
+    return memcmp(bench->expected, bench->actual, bench->num_pixels) == 0;
+}
+
+static void diffusion_body(DitherBench *bench, void *ctx) {
+    (void)ctx;
+    printf("%-12s %12s %12s %8s  %s\n", "kernel", "legacy MP/s", "engine MP/s", "speedup", "identical");
+    for (size_t k = 0; k < sizeof(diffusion_kernels) / sizeof(diffusion_kernels[0]); k++) {
+        double engine = time_dither(NULL, diffusion_kernels[k].method, &bench->src, bench->actual, &bench->theme);
+        if (!diffusion_kernels[k].legacy) {
+            printf("%-12s %12s %12.2f %8s  %s\n", diffusion_kernels[k].name, "-", engine, "-", "-");
+            continue;
+        }
+        double legacy = time_dither(diffusion_kernels[k].legacy, DITHER_NONE, &bench->src, bench->expected,
+                                    &bench->theme);
+        printf("%-12s %12.2f %12.2f %7.2fx  %s\n", diffusion_kernels[k].name, legacy, engine, engine / legacy,
+               same_indices(bench) ? "yes" : "no");
+    }
+}
+
+// error-diffusion throughput of the table-driven engine against the old
+// per-kernel loops, on a mostly-interior frame
+static int bench_diffusion(int argc, char **argv) {
+    return run_dither_bench(argc > 0 ? argv[0] : NULL, DIFFUSION_WIDTH, DIFFUSION_HEIGHT, diffusion_body, NULL);
+}
+
+// how far the dithered image's 8x8 block averages stray from the source's,
+// per channel level; diffusion engines that keep the tone agree here even
+// where their patterns differ
+static double tone_error(const unsigned char *pixels, const uint8_t *indices, const Theme *theme, int width,
+                         int height) {
+    double total = 0.0;
+    int blocks = 0;
+    for (int by = 0; by + 8 <= height; by += 8) {
+        for (int bx = 0; bx + 8 <= width; bx += 8) {
+            for (int c = 0; c < 3; c++) {
+                int source = 0, dithered = 0;
+                for (int y = by; y < by + 8; y++) {
+                    for (int x = bx; x < bx + 8; x++) {
+                        size_t i = (size_t)y * width + x;
+                        const uint8_t *color = &theme->palette[indices[i]].r;
+                        source += pixels[i * 3 + c];
+                        dithered += color[c];
+                    }
+                }
+                total += fabs((source - dithered) / 64.0);
+            }
+            blocks++;
+        }
+    }
+    return total / (blocks * 3);
+}
+
+static void integer_body(DitherBench *bench, void *ctx) {
+    (void)ctx;
+    const PixelSource *src = &bench->src;
+    printf("%-12s %11s %11s %8s %9s %11s %11s\n", "kernel", "float MP/s", "int16 MP/s", "speedup", "same",
+           "float tone", "int16 tone");
+    for (size_t k = 0; k < sizeof(diffusion_kernels) / sizeof(diffusion_kernels[0]); k++) {
+        fixed_diffusion = 0;
+        double direct = time_dither(NULL, diffusion_kernels[k].method, src, bench->expected, &bench->theme);
+        fixed_diffusion = 1;
+        double integer = time_dither(NULL, diffusion_kernels[k].method, src, bench->actual, &bench->theme);
+        size_t same = 0;
+        for (size_t i = 0; i < bench->num_pixels; i++) same += bench->expected[i] == bench->actual[i];
+        printf("%-12s %11.2f %11.2f %7.2fx %8.2f%% %11.3f %11.3f\n", diffusion_kernels[k].name, direct, integer,
+               integer / direct, same * 100.0 / bench->num_pixels,
+               tone_error(src->pixels, bench->expected, &bench->theme, src->width, src->height),
+               tone_error(src->pixels, bench->actual, &bench->theme, src->width, src->height));
+    }
+    fixed_diffusion = 0;
+}
+
+// the int16 engine behind -D against the float one, per kernel
+static int bench_integer(int argc, char **argv) {
+    return run_dither_bench(argc > 0 ? argv[0] : NULL, DIFFUSION_WIDTH, DIFFUSION_HEIGHT, integer_body, NULL);
+}
+
+#define WAVEFRONT_WIDTH 4096
+#define WAVEFRONT_HEIGHT 3072
+
+static const struct {
+    const char *name;
+    DitherFn run;
+} point_dithers[] = {
+    { "nodither", apply_no_dither },
+    { "ordered", apply_ordered_dither },
+    { "bayer", apply_bayer_dither },
+};
+
+typedef struct {
+    int max_threads;
+    int point;  // the point dithers rather than the diffusion kernels
+} ScalingRun;
+
+// throughput of each function from 1 to max_threads threads, checking each
+// run against the single-threaded indices
+static void scaling_body(DitherBench *bench, void *ctx) {
+    const ScalingRun *run = ctx;
+    size_t count = run->point ? sizeof(point_dithers) / sizeof(point_dithers[0])
+                              : sizeof(diffusion_kernels) / sizeof(diffusion_kernels[0]);
+    printf("%-12s", "MP/s");
+    for (int t = 1; t <= run->max_threads; t++) printf(" %7dt", t);
+    printf("  identical\n");
+    for (size_t k = 0; k < count; k++) {
+        DitherFn legacy = run->point ? point_dithers[k].run : NULL;
+        DitherMethod method = run->point ? DITHER_NONE : diffusion_kernels[k].method;
+        int identical = 1;
+        printf("%-12s", run->point ? point_dithers[k].name : diffusion_kernels[k].name);
+        for (int t = 1; t <= run->max_threads; t++) {
+            num_threads = t;
+            double mps = time_dither(legacy, method, &bench->src, t == 1 ? bench->expected : bench->actual,
+                                     &bench->theme);
+            if (t > 1) identical &= same_indices(bench);
+            printf(" %8.2f", mps);
+            fflush(stdout);
+        }
+        printf("  %s\n", identical ? "yes" : "no");
+    }
+}
+
+static int bench_scaling(int argc, char **argv, int point) {
+    ScalingRun run = { .max_threads = argc > 0 ? atoi(argv[0]) : (int)sysconf(_SC_NPROCESSORS_ONLN), .point = point };
+    if (run.max_threads < 1) run.max_threads = 1;
+    if (run.max_threads > MAX_THREADS) run.max_threads = MAX_THREADS;
+    return run_dither_bench(argc > 1 ? argv[1] : NULL, WAVEFRONT_WIDTH, WAVEFRONT_HEIGHT, scaling_body, &run);
+}
+
+// wavefront scaling of every diffusion kernel from 1 to max_threads threads
+static int bench_wavefront(int argc, char **argv) {
+    return bench_scaling(argc, argv, 0);
+}
+
+// band-parallel scaling of the point dithers from 1 to max_threads threads
+static int bench_point(int argc, char **argv) {
+    return bench_scaling(argc, argv, 1);
+}
+
+static void graded_body(DitherBench *bench, void *ctx) {
+    (void)ctx;
+    PointEffects grading = { .grading = 1, .brightness = 10.0f, .contrast = 1.2f, .saturation = 1.3f };
+    PixelSource *src = &bench->src;
+    src->effects = &grading;
+
+    printf("%-12s %10s %10s %10s  identical\n", "MP/s", "float", "first", "cached");
+    for (size_t k = 0; k < sizeof(point_dithers) / sizeof(point_dithers[0]); k++) {
+        src->graded = 0;
+        double direct = time_dither(point_dithers[k].run, DITHER_NONE, src, bench->expected, &bench->theme);
+
+        initialize_graded_cache(&grading, point_dithers[k].run == apply_no_dither);
+        src->graded = 1;
+        double start = now_seconds();
+        point_dithers[k].run(src, bench->actual, &bench->theme);
+        double first = bench->num_pixels / (now_seconds() - start) / 1e6;
+        int identical = same_indices(bench);
+        double cached = time_dither(point_dithers[k].run, DITHER_NONE, src, bench->actual, &bench->theme);
+        identical &= same_indices(bench);
+        free_graded_cache();
+
+        printf("%-12s %10.2f %10.2f %10.2f  %s\n", point_dithers[k].name, direct, first, cached,
+               identical ? "yes" : "no");
+    }
+    src->effects = NULL;
+}
+
+// the point dithers under -B/-C/-S, grading each row in float against the
+// graded cache, both the first run that fills it and later ones
+static int bench_graded(int argc, char **argv) {
+    return run_dither_bench(argc > 0 ? argv[0] : NULL, WAVEFRONT_WIDTH, WAVEFRONT_HEIGHT, graded_body, NULL);
+}
+
+// the box blur before it kept a running sum, re-adding the whole window for
+// every pixel in both passes
+static void legacy_box_blur(float *image_f, int width, int height, int blur_strength) {
+    if (blur_strength < 1) return;
+
+    int channels = 3;
+    float *temp = malloc(width * height * channels * sizeof(float));
+    if (!temp) {
+        fprintf(stderr, "error: could not allocate memory for blur operation.\n");
+        exit(1);
+    }
+
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            float sum_r = 0.0f, sum_g = 0.0f, sum_b = 0.0f;
+            int count = 0;
+            for (int i = -blur_strength; i <= blur_strength; i++) {
+                int nx = x + i;
+                if (nx < 0 || nx >= width) continue;
+                int n_idx = (y * width + nx) * channels;
+                sum_r += image_f[n_idx];
+                sum_g += image_f[n_idx + 1];
+                sum_b += image_f[n_idx + 2];
+                count++;
+            }
+            int idx = (y * width + x) * channels;
+            temp[idx]     = sum_r / count;
+            temp[idx + 1] = sum_g / count;
+            temp[idx + 2] = sum_b / count;
+        }
+    }
+
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            float sum_r = 0.0f, sum_g = 0.0f, sum_b = 0.0f;
+            int count = 0;
+            for (int i = -blur_strength; i <= blur_strength; i++) {
+                int ny = y + i;
+                if (ny < 0 || ny >= height) continue;
+                int n_idx = (ny * width + x) * channels;
+                sum_r += temp[n_idx];
+                sum_g += temp[n_idx + 1];
+                sum_b += temp[n_idx + 2];
+                count++;
+            }
+            int idx = (y * width + x) * channels;
+            image_f[idx]     = sum_r / count;
+            image_f[idx + 1] = sum_g / count;
+            image_f[idx + 2] = sum_b / count;
+        }
+    }
+
+    free(temp);
+}
+
+#define BLUR_WIDTH 1024
+#define BLUR_HEIGHT 768
+
+static float *blur_frame(const unsigned char *pixels, size_t count) {
+    float *image_f = malloc(count * sizeof(float));
+    if (!image_f) {
+        fprintf(stderr, "error: could not allocate memory for benchmark.\n");
+        exit(1);
+    }
+    for (size_t i = 0; i < count; i++) image_f[i] = pixels[i];
+    return image_f;
+}
+
+// sliding-window box blur against the old per-pixel window sums, over radii
+// 1 to 100
+static int bench_blur(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+    size_t count = (size_t)BLUR_WIDTH * BLUR_HEIGHT * 3;
+    unsigned char *pixels = synthetic_frame(BLUR_WIDTH, BLUR_HEIGHT);
+    static const int radii[] = { 1, 2, 3, 5, 10, 20, 30, 50, 75, 100 };
+    printf("%-6s %10s %10s %8s  %s\n", "radius", "legacy ms", "sliding ms", "speedup", "max diff");
+    for (size_t r = 0; r < sizeof(radii) / sizeof(radii[0]); r++) {
+        float *expected = blur_frame(pixels, count);
+        float *actual = blur_frame(pixels, count);
+        double start = now_seconds();
+        legacy_box_blur(expected, BLUR_WIDTH, BLUR_HEIGHT, radii[r]);
+        double legacy = now_seconds() - start;
+        start = now_seconds();
+        apply_box_blur(actual, BLUR_WIDTH, BLUR_HEIGHT, radii[r]);
+        double sliding = now_seconds() - start;
+
+        float max_diff = 0.0f;
+        for (size_t i = 0; i < count; i++) {
+            float diff = fabsf(expected[i] - actual[i]);
+            if (diff > max_diff) max_diff = diff;
+        }
+        printf("%-6d %10.2f %10.2f %7.1fx  %g\n", radii[r], legacy * 1000.0, sliding * 1000.0, legacy / sliding,
+               max_diff);
+        free(expected);
+        free(actual);
+    }
+    free(pixels);
+    return 0;
+}
+
+#define PASSES_WIDTH 16384
+#define PASSES_HEIGHT 256
+
+// the two box blur passes timed separately on a very wide frame, where a
+// column walk misses cache on every tap
+static int bench_blur_passes(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+    size_t count = (size_t)PASSES_WIDTH * PASSES_HEIGHT * 3;
+    unsigned char *pixels = synthetic_frame(PASSES_WIDTH, PASSES_HEIGHT);
+    float *in = blur_frame(pixels, count);
+    float *out = blur_frame(pixels, count);
+    static const int radii[] = { 1, 5, 20, 100 };
+    printf("%-6s %14s %14s\n", "radius", "horizontal ms", "vertical ms");
+    for (size_t r = 0; r < sizeof(radii) / sizeof(radii[0]); r++) {
+        double start = now_seconds();
+        box_blur_rows(in, out, PASSES_WIDTH, PASSES_HEIGHT, radii[r]);
+        double rows = now_seconds() - start;
+        start = now_seconds();
+        box_blur_columns(in, out, PASSES_WIDTH, PASSES_HEIGHT, radii[r]);
+        double columns = now_seconds() - start;
+        printf("%-6d %14.2f %14.2f\n", radii[r], rows * 1000.0, columns * 1000.0);
+    }
+    free(in);
+    free(out);
+    free(pixels);
+    return 0;
+}
+
+// the spread of the blurred impulse at the centre of a blank frame, which
+// should match the requested sigma
+static float impulse_sigma(float sigma) {
+    int size = 8 * (int)ceilf(sigma) + 33;
+    float *image_f = calloc((size_t)size * size * 3, sizeof(float));
+    if (!image_f) {
+        fprintf(stderr, "error: could not allocate memory for benchmark.\n");
+        exit(1);
+    }
+    int c = size / 2;
+    image_f[((size_t)c * size + c) * 3] = 1.0f;
+    apply_gaussian_blur(image_f, size, size, sigma);
+    double total = 0.0, variance = 0.0;
+    for (int x = 0; x < size; x++) {
+        float v = image_f[((size_t)c * size + x) * 3];
+        total += v;
+        variance += v * (double)(x - c) * (x - c);
+    }
+    free(image_f);
+    return (float)sqrt(variance / total);
+}
+
+// gaussian blur time over sigma on a 1024x768 frame, and the sigma actually
+// achieved by the three box passes
+static int bench_gaussian(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+    size_t count = (size_t)BLUR_WIDTH * BLUR_HEIGHT * 3;
+    unsigned char *pixels = synthetic_frame(BLUR_WIDTH, BLUR_HEIGHT);
+    static const float sigmas[] = { 0.5f, 1.0f, 2.0f, 5.0f, 10.0f, 25.0f, 50.0f, 100.0f };
+    printf("%-6s %10s %10s\n", "sigma", "ms", "measured");
+    for (size_t i = 0; i < sizeof(sigmas) / sizeof(sigmas[0]); i++) {
+        float *image_f = blur_frame(pixels, count);
+        double start = now_seconds();
+        apply_gaussian_blur(image_f, BLUR_WIDTH, BLUR_HEIGHT, sigmas[i]);
+        double elapsed = now_seconds() - start;
+        printf("%-6g %10.2f %10.2f\n", sigmas[i], elapsed * 1000.0, impulse_sigma(sigmas[i]));
+        free(image_f);
+    }
+    free(pixels);
+    return 0;
+}
+
+// the 8.8 fixed-point blurs against the float ones on a 4096x3072 frame:
+// time, and how far the 8-bit levels the dither stage reads drift apart
+static void compare_fixed(const char *name, float amount, const unsigned char *pixels, int gaussian) {
+    size_t count = (size_t)WAVEFRONT_WIDTH * WAVEFRONT_HEIGHT * 3;
+    float *image_f = blur_frame(pixels, count);
+    uint16_t *image_fixed = alloc_fixed_image(WAVEFRONT_WIDTH, WAVEFRONT_HEIGHT);
+    fixed_from_pixels(image_fixed, pixels, count);
+
+    double start = now_seconds();
+    if (gaussian) apply_gaussian_blur(image_f, WAVEFRONT_WIDTH, WAVEFRONT_HEIGHT, amount);
+    else apply_box_blur(image_f, WAVEFRONT_WIDTH, WAVEFRONT_HEIGHT, (int)amount);
+    double float_ms = (now_seconds() - start) * 1000.0;
+    start = now_seconds();
+    if (gaussian) apply_gaussian_blur_fixed(image_fixed, WAVEFRONT_WIDTH, WAVEFRONT_HEIGHT, amount);
+    else apply_box_blur_fixed(image_fixed, WAVEFRONT_WIDTH, WAVEFRONT_HEIGHT, (int)amount);
+    double fixed_ms = (now_seconds() - start) * 1000.0;
+
+    int max_diff = 0;
+    size_t differing = 0;
+    for (size_t i = 0; i < count; i++) {
+        int diff = abs(clamp_float(image_f[i]) - clamp_float(image_fixed[i] / 256.0f));
+        if (diff > max_diff) max_diff = diff;
+        differing += diff != 0;
+    }
+    printf("%-9s %6g %10.2f %10.2f %8d %9.4f%%\n", name, amount, float_ms, fixed_ms, max_diff,
+           differing * 100.0 / count);
+    free(image_f);
+    free(image_fixed);
+}
+
+static int bench_fixed(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+    unsigned char *pixels = synthetic_frame(WAVEFRONT_WIDTH, WAVEFRONT_HEIGHT);
+    static const int radii[] = { 1, 3, 10, 50 };
+    static const float sigmas[] = { 1.0f, 2.5f, 10.0f, 50.0f };
+    printf("working image: float %zu B/pixel, fixed %zu B/pixel (with the blur buffer)\n\n",
+           2 * 3 * sizeof(float), 2 * 3 * sizeof(uint16_t));
+    printf("%-9s %6s %10s %10s %8s %10s\n", "blur", "size", "float ms", "fixed ms", "max diff", "differing");
+    for (size_t i = 0; i < sizeof(radii) / sizeof(radii[0]); i++) compare_fixed("box", radii[i], pixels, 0);
+    for (size_t i = 0; i < sizeof(sigmas) / sizeof(sigmas[0]); i++) {
+        compare_fixed("gaussian", sigmas[i], pixels, 1);
+    }
+    free(pixels);
+    return 0;
+}
+
+// the panavision row as it was before the vignette was tabulated
+static void legacy_panavision_row(const PointEffects *fx, float *row, int y, int width, int height) {
+    uint32_t row_key = grain_row_key(fx->seed, y);
+    float max_distance = sqrtf(powf(width / 2.0f, 2) + powf(height / 2.0f, 2));
+    for (int x = 0; x < width; x++) {
+        float *p = row + x * 3;
+        float distance = sqrtf(powf(x - width / 2.0f, 2) + powf(y - height / 2.0f, 2));
+        float vignette = 1.0f - (distance / max_distance) * 0.5f * fx->panavision_strength;
+        float grain = grain_noise(row_key, x, 3) * fx->panavision_strength;
+        for (int c = 0; c < 3; c++) {
+            p[c] *= vignette;
+            p[c] += grain;
+            if (p[c] < 0.0f) p[c] = 0.0f;
+            if (p[c] > 255.0f) p[c] = 255.0f;
+        }
+    }
+}
+
+// per-row cost of the point effects on a 4096x3072 frame, with the
+// panavision vignette also timed against the per-pixel powf version
+static int bench_effects(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+    unsigned char *pixels = synthetic_frame(WAVEFRONT_WIDTH, WAVEFRONT_HEIGHT);
+    float *row = alloc_row(WAVEFRONT_WIDTH);
+    float *expected = alloc_row(WAVEFRONT_WIDTH);
+    PixelSource src = { .pixels = pixels, .width = WAVEFRONT_WIDTH, .height = WAVEFRONT_HEIGHT };
+    const Vignette *vignette = prepare_vignette(WAVEFRONT_WIDTH, WAVEFRONT_HEIGHT);
+    static const struct {
+        const char *name;
+        PointEffects fx;
+    } cases[] = {
+        { "none", { 1, 0, 0, NULL, 0, 0.0f, 1.0f, 1.0f } },
+        { "super8", { 1, 2, 0, NULL, 0, 0.0f, 1.0f, 1.0f } },
+        { "panavision", { 1, 0, 2, NULL, 0, 0.0f, 1.0f, 1.0f } },
+        { "grading", { 1, 0, 0, NULL, 1, 10.0f, 1.2f, 1.3f } },
+        { "all", { 1, 2, 2, NULL, 1, 10.0f, 1.2f, 1.3f } },
+    };
+    printf("%-12s %10s\n", "effects", "ns/pixel");
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        PointEffects fx = cases[i].fx;
+        fx.vignette = vignette;
+        src.effects = &fx;
+        double start = now_seconds();
+        for (int y = 0; y < WAVEFRONT_HEIGHT; y++) load_source_row(&src, y, row);
+        double elapsed = now_seconds() - start;
+        printf("%-12s %10.2f\n", cases[i].name, elapsed * 1e9 / ((double)WAVEFRONT_WIDTH * WAVEFRONT_HEIGHT));
+    }
+
+    PointEffects fx = cases[2].fx;
+    fx.vignette = vignette;
+    src.effects = NULL;
+    double legacy = 0.0, tabulated = 0.0;
+    int identical = 1;
+    for (int y = 0; y < WAVEFRONT_HEIGHT; y++) {
+        load_source_row(&src, y, expected);
+        double start = now_seconds();
+        legacy_panavision_row(&fx, expected, y, WAVEFRONT_WIDTH, WAVEFRONT_HEIGHT);
+        legacy += now_seconds() - start;
+        load_source_row(&src, y, row);
+        start = now_seconds();
+        apply_point_effects(&fx, row, y, WAVEFRONT_WIDTH);
+        tabulated += now_seconds() - start;
+        identical &= memcmp(expected, row, WAVEFRONT_WIDTH * 3 * sizeof(float)) == 0;
+    }
+    double n = (double)WAVEFRONT_WIDTH * WAVEFRONT_HEIGHT;
+    printf("\npanavision   legacy %.2f ns/pixel, tabulated %.2f ns/pixel, identical: %s\n",
+           legacy * 1e9 / n, tabulated * 1e9 / n, identical ? "yes" : "no");
+
+    free(row);
+    free(expected);
+    free(pixels);
+    free_vignette();
+    return 0;
+}
+
+// grading a pixel at a time on the interleaved row against the planar
+// chunks apply_point_effects uses, on 4k and 8k frames
+static int bench_planar(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+    static const struct {
+        const char *name;
+        int width;
+        int height;
+    } frames[] = { { "4k", 3840, 2160 }, { "8k", 7680, 4320 } };
+    PointEffects grading = { .grading = 1, .brightness = 10.0f, .contrast = 1.2f, .saturation = 1.3f };
+    printf("%-6s %12s %12s %8s  %s\n", "frame", "interleaved", "planar", "speedup", "identical");
+    for (size_t f = 0; f < sizeof(frames) / sizeof(frames[0]); f++) {
+        int width = frames[f].width, height = frames[f].height;
+        unsigned char *pixels = synthetic_frame(width, height);
+        float *row = alloc_row(width);
+        float *expected = alloc_row(width);
+        PixelSource src = { .pixels = pixels, .width = width, .height = height };
+        double interleaved = 0.0, planar = 0.0;
+        int identical = 1;
+        for (int y = 0; y < height; y++) {
+            load_source_row(&src, y, expected);
+            double start = now_seconds();
+            for (int i = 0; i < width * 3; i += 3) grade_pixel(&grading, expected + i);
+            interleaved += now_seconds() - start;
+            load_source_row(&src, y, row);
+            start = now_seconds();
+            grade_row(&grading, row, width);
+            planar += now_seconds() - start;
+            identical &= memcmp(expected, row, width * 3 * sizeof(float)) == 0;
+        }
+        double n = (double)width * height;
+        printf("%-6s %9.2f ns %9.2f ns %7.2fx  %s\n", frames[f].name, interleaved * 1e9 / n, planar * 1e9 / n,
+               interleaved / planar, identical ? "yes" : "no");
+        free(row);
+        free(expected);
+        free(pixels);
+    }
+    return 0;
+}
+
+// direct grading against the same grading baked into luts of growing size:
+// ns per pixel for each interpolation, and the largest error on a frame
+static int bench_lut(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+    unsigned char *pixels = synthetic_frame(WAVEFRONT_WIDTH, WAVEFRONT_HEIGHT);
+    float *row = alloc_row(WAVEFRONT_WIDTH);
+    float *expected = alloc_row(WAVEFRONT_WIDTH);
+    PixelSource src = { .pixels = pixels, .width = WAVEFRONT_WIDTH, .height = WAVEFRONT_HEIGHT };
+    PointEffects grading = { .grading = 1, .brightness = 10.0f, .contrast = 1.2f, .saturation = 1.3f };
+    double n = (double)WAVEFRONT_WIDTH * WAVEFRONT_HEIGHT;
+
+    src.effects = &grading;
+    double start = now_seconds();
+    for (int y = 0; y < WAVEFRONT_HEIGHT; y++) load_source_row(&src, y, row);
+    printf("direct grading %.2f ns/pixel\n\n", (now_seconds() - start) * 1e9 / n);
+
+    static const int sizes[] = { 17, 33, 65 };
+    printf("%-5s %-12s %10s %10s\n", "size", "interp", "ns/pixel", "max error");
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        for (int interp = LUT_TETRAHEDRAL; interp <= LUT_TRILINEAR; interp++) {
+            Lut3D lut;
+            if (bake_grading_lut(&grading, NULL, sizes[i], (LutInterp)interp, &lut) != 0) return 1;
+            PointEffects fx = { .lut = &lut };
+            src.effects = &fx;
+            start = now_seconds();
+            for (int y = 0; y < WAVEFRONT_HEIGHT; y++) load_source_row(&src, y, row);
+            double elapsed = now_seconds() - start;
+
+            float max_error = 0.0f;
+            for (int y = 0; y < WAVEFRONT_HEIGHT; y += 7) {
+                src.effects = &grading;
+                load_source_row(&src, y, expected);
+                src.effects = &fx;
+                load_source_row(&src, y, row);
+                for (int x = 0; x < WAVEFRONT_WIDTH * 3; x++) {
+                    float error = fabsf(row[x] - expected[x]);
+                    if (error > max_error) max_error = error;
+                }
+            }
+            printf("%-5d %-12s %10.2f %10.3f\n", sizes[i], lut_interp_names[interp], elapsed * 1e9 / n, max_error);
+            free_lut(&lut);
+        }
+    }
+
+    free(row);
+    free(expected);
+    free(pixels);
+    return 0;
+}
+
+typedef struct {
+    const char *name;
+    const char *args;
+    int (*run)(int argc, char **argv);
+} Benchmark;
+
+static const Benchmark benchmarks[] = {
+    { "search", "<palette_file>...", bench_search },
+    { "metrics", "<palette_file>...", bench_metrics },
+    { "diffusion", "[palette_file]", bench_diffusion },
+    { "integer", "[palette_file]", bench_integer },
+    { "wavefront", "[max_threads] [palette_file]", bench_wavefront },
+    { "point", "[max_threads] [palette_file]", bench_point },
+    { "graded", "[palette_file]", bench_graded },
+    { "blur", "", bench_blur },
+    { "blur-passes", "", bench_blur_passes },
+    { "gaussian", "", bench_gaussian },
+    { "fixed", "", bench_fixed },
+    { "effects", "", bench_effects },
+    { "planar", "", bench_planar },
+    { "lut", "", bench_lut },
+};
+
+int main(int argc, char *argv[]) {
+    size_t count = sizeof(benchmarks) / sizeof(benchmarks[0]);
+    if (argc >= 2) {
+        for (size_t i = 0; i < count; i++) {
+            if (strcmp(argv[1], benchmarks[i].name) == 0) {
+                return benchmarks[i].run(argc - 2, argv + 2);
+            }
+        }
+    }
+    fprintf(stderr, "usage: %s <benchmark> [args]\n", argv[0]);
+    for (size_t i = 0; i < count; i++) {
+        fprintf(stderr, "  %s %s\n", benchmarks[i].name, benchmarks[i].args);
+    }
+    return 1;
+}